@@ -3,8 +3,21 @@
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <chrono>
 #include "mint.hpp"
 
+auto startTime = std::chrono::steady_clock::now();
+
+double elapsed() {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       startTime).count();
+}
+
 size_t split(const std::string &txt, std::vector<std::string> &strs, char ch) {
     size_t pos = txt.find(ch);
     size_t initialPos = 0;
@@ -25,51 +38,234 @@ size_t split(const std::string &txt, std::vector<std::string> &strs, char ch) {
     return strs.size();
 }
 
-int loadFiles(int argc, char** argv, std::vector<Edge>& edgeList,
-              std::vector<Edge>& motif) {
-  if (argc < 3) {
-    std::cerr <<
-        "Error: must provide temporal graph and target motif data files." <<
-        std::endl;
-    return 1;
-  } else if (argc > 3) {
-    std::cerr << "Error: unrecognized argument(s)." << std::endl;
+Edge parseEdge(const std::string& line) {
+  std::vector<std::string> v;
+  Edge e;
+  split(line, v, ' ');
+  e.u = std::stoi(v[0]);
+  e.v = std::stoi(v[1]);
+  e.time = std::stoi(v[2]);
+  return e;
+}
+
+int loadGraph(char* path, std::vector<Edge>& edgeList) {
+  std::ifstream dataFileG(path);
+  std::string line;
+  if (dataFileG.is_open()) {
+    while (std::getline(dataFileG, line)) {
+      edgeList.push_back(parseEdge(line));
+    }
+    dataFileG.close();
+  } else {
+    std::cerr << "Error: could not open provided graph data file." << std::endl;
     return 1;
   }
-  std::ifstream dataFileG(argv[1]);
+  return 0;
+}
+
+// First pass over the graph for out-of-core and pipelined runs: count the
+// edges of every vertex and vertex pair without keeping the edges themselves.
+int countGraph(char* path, EdgeStore& store) {
+  std::ifstream dataFileG(path);
   std::string line;
   if (dataFileG.is_open()) {
+    int lastTime = 0;
     while (std::getline(dataFileG, line)) {
-      std::vector<std::string> v;
-      Edge e;
-      split(line, v, ' ');
-      e.u = std::stoi(v[0]);
-      e.v = std::stoi(v[1]);
-      e.time = std::stoi(v[2]);
-      edgeList.push_back(e);
+      Edge e = parseEdge(line);
+      if (store.size() > 0 && e.time < lastTime) {
+        std::cerr << "Error: graph edges must be sorted by time to be " <<
+            "streamed." << std::endl;
+        return 1;
+      }
+      lastTime = e.time;
+      store.count(e);
     }
+    store.seal();
     dataFileG.close();
   } else {
     std::cerr << "Error: could not open provided graph data file." << std::endl;
     return 1;
   }
-  std::ifstream dataFileM(argv[2]);
+  return 0;
+}
+
+// Reads graph edges on a background thread and hands them over in batches of
+// PIPELINE_BATCH, keeping at most SLAB_EDGES of them waiting. With counting
+// set it also counts every edge it reads into counts, which is sealed by the
+// time the last batch is taken.
+class EdgeLoader {
+ public:
+  std::atomic<size_t> watermark{0};
+  EdgeStore counts;
+  bool unsorted = false;
+
+  EdgeLoader(std::ifstream& f, bool c):
+      file(f), counting(c), worker(&EdgeLoader::load, this) {}
+
+  ~EdgeLoader() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stop = true;
+    }
+    space.notify_one();
+    worker.join();
+  }
+
+  // Append every edge read so far to store, waiting for a batch if none is
+  // ready. Returns false once the whole file has been handed over, or the
+  // loader stopped at an edge out of time order.
+  bool take(EdgeStore& store) {
+    std::deque<std::vector<Edge>> taken;
+    bool more;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      ready.wait(lock, [this] { return !batches.empty() || done; });
+      taken.swap(batches);
+      queued = 0;
+      more = !done;
+    }
+    space.notify_one();
+    for (size_t i = 0; i < taken.size(); i++) {
+      for (size_t j = 0; j < taken.at(i).size(); j++) {
+        store.append(taken.at(i).at(j));
+      }
+    }
+    return more;
+  }
+
+ private:
+  std::ifstream& file;
+  bool counting;
+  std::mutex mutex;
+  std::condition_variable ready;
+  std::condition_variable space;
+  std::deque<std::vector<Edge>> batches;
+  size_t queued = 0;
+  bool done = false;
+  bool stop = false;
+  std::thread worker;
+
+  void load() {
+    std::string line;
+    std::vector<Edge> batch;
+    int lastTime = 0;
+    bool sorted = true;
+    while (std::getline(file, line)) {
+      Edge e = parseEdge(line);
+      if (watermark + batch.size() > 0 && e.time < lastTime) {
+        sorted = false;
+        break;
+      }
+      lastTime = e.time;
+      if (counting) counts.count(e);
+      batch.push_back(e);
+      if (batch.size() == PIPELINE_BATCH && !publish(batch)) return;
+    }
+    if (counting) counts.seal();
+    publish(batch);
+    std::lock_guard<std::mutex> lock(mutex);
+    unsorted = !sorted;
+    done = true;
+    ready.notify_one();
+  }
+
+  bool publish(std::vector<Edge>& batch) {
+    std::unique_lock<std::mutex> lock(mutex);
+    space.wait(lock, [this] { return queued < SLAB_EDGES || stop; });
+    if (stop) return false;
+    queued += batch.size();
+    watermark += batch.size();
+    batches.push_back(std::move(batch));
+    batch.clear();
+    ready.notify_one();
+    return true;
+  }
+};
+
+// Second pass for out-of-core and pipelined runs: read the graph SLAB_EDGES
+// edges at a time, or as fast as the loader thread publishes them, and run
+// every root whose time window is fully loaded. Out of core, the edges no
+// later or unfinished root can reach are then dropped.
+int streamGraph(char* path, Mint& mint) {
+  std::ifstream dataFileG(path);
+  std::string line;
+  if (!dataFileG.is_open()) {
+    std::cerr << "Error: could not open provided graph data file." << std::endl;
+    return 1;
+  }
+  EdgeStore& store = mint.edgeList;
+  EdgeLoader* loader = nullptr;
+  if (PIPELINE) loader = new EdgeLoader(dataFileG, store.partial);
+  size_t next = 0;
+  bool more = true;
+  while (more) {
+    if (PIPELINE) {
+      more = loader->take(store);
+      if (!more && loader->unsorted) {
+        std::cerr << "Error: graph edges must be sorted by time to be " <<
+            "streamed." << std::endl;
+        delete loader;
+        return 1;
+      }
+      if (!more && store.partial) {
+        // The whole graph is counted, charge what the searches so far missed
+        store.adopt(loader->counts);
+        mint.settle();
+      }
+    } else {
+      size_t read = 0;
+      while (read < SLAB_EDGES &&
+             (more = (bool)std::getline(dataFileG, line))) {
+        Edge e = parseEdge(line);
+        store.append(e);
+        read++;
+      }
+    }
+    if (store.loaded() == next) continue;
+    size_t to = store.loaded();
+    if (more) {
+      // A root can run once an edge past the end of its window is loaded
+      int lastTime = store.at(store.loaded() - 1).time;
+      to = next;
+      while (to < store.loaded() &&
+             store.at(to).time + mint.tM.time < lastTime) {
+        to++;
+      }
+    }
+    if (to == next) continue;
+    if (VERBOSE) std::cout << "Running roots " << next << " to " << to <<
+                     " with " << store.edges.size() << " resident edges" <<
+                     std::endl;
+    if (PIPELINE && next == 0) {
+      std::cout << "Released first root tasks after " << elapsed() <<
+          " s with " << loader->watermark << " edges loaded" << std::endl;
+    }
+    mint.runRoots(next, to);
+    if (OUT_OF_CORE) store.evict(std::min(to, mint.oldestRoot()));
+    next = to;
+  }
+  delete loader;
+  dataFileG.close();
+  if (store.size() != next) {
+    std::cerr << "Error: graph data file changed while streaming." << std::endl;
+    return 1;
+  }
+  return 0;
+}
+
+int loadMotif(char* path, std::vector<Edge>& motif) {
+  std::ifstream dataFileM(path);
+  std::string line;
   if (dataFileM.is_open()) {
     size_t i = 0;
     while (std::getline(dataFileM, line)) {
-      std::vector<std::string> v;
-      Edge e;
-      split(line, v, ' ');
       if (i > motif.size()) {
         std::cerr <<
             "Error: motif is too large. Recompile with larger MOTIF_SIZE." <<
             std::endl;
         return 1;
       }
-      e.u = std::stoi(v[0]);
-      e.v = std::stoi(v[1]);
-      e.time = std::stoi(v[2]);
-      motif.push_back(e);
+      motif.push_back(parseEdge(line));
       i++;
     }
     dataFileM.close();
@@ -82,14 +278,67 @@ int loadFiles(int argc, char** argv, std::vector<Edge>& edgeList,
 
 int main(int argc, char** argv) {
   TargetMotif tM;
-  std::vector<Edge> edgeList;
+  if (argc < 3) {
+    std::cerr <<
+        "Error: must provide temporal graph and target motif data files." <<
+        std::endl;
+    return 1;
+  } else if (argc > 3) {
+    std::cerr << "Error: unrecognized argument(s)." << std::endl;
+    return 1;
+  }
   std::cout << "Loading files" << std::endl;
-  int result = loadFiles(argc, argv, edgeList, tM.motif);
+  int result = loadMotif(argv[2], tM.motif);
+  if (result != 0) {
+    return result;
+  }
+  if (TUNE) {
+    std::vector<Edge> edgeList;
+    result = loadGraph(argv[1], edgeList);
+    if (result != 0) {
+      return result;
+    }
+    EdgeStore store(edgeList);
+    std::cout << "Tuning Mint" << std::endl;
+    Tuner tuner(tM, store, TUNE_BUDGET);
+    tuner.search();
+    tuner.report();
+    return 0;
+  }
+  if (OUT_OF_CORE || PIPELINE) {
+    EdgeStore store;
+    if (PIPELINE && NUM_CONTEXTS == 1 && !FULL_ASYNC && !DRAM_MODEL &&
+        !TRACE) {
+      // Count while loading, search costs that depend on the counts are only
+      // added up, not used for scheduling, so they can be charged at the end
+      store.counted = true;
+      store.partial = true;
+    } else {
+      result = countGraph(argv[1], store);
+      if (result != 0) {
+        return result;
+      }
+    }
+    if (VERBOSE) std::cout << "Constructing Mint" << std::endl;
+    Mint mint(tM, std::move(store));
+    std::cout << "Running Mint " <<
+        (OUT_OF_CORE ? "out of core" : "while loading") << std::endl;
+    result = streamGraph(argv[1], mint);
+    if (result != 0) {
+      return result;
+    }
+    mint.finish();
+    if (PIPELINE) std::cout << "Finished after " << elapsed() << " s" <<
+                      std::endl;
+    return 0;
+  }
+  std::vector<Edge> edgeList;
+  result = loadGraph(argv[1], edgeList);
   if (result != 0) {
     return result;
   }
   if (VERBOSE) std::cout << "Constructing Mint" << std::endl;
-  Mint mint(tM, edgeList);
+  Mint mint(tM, EdgeStore(edgeList));
   std::cout << "Running Mint" << std::endl;
   mint.run();
   return 0;
@@ -1,6 +1,11 @@
 // Definitions for Mint simulator
 
 #include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <omp.h>
+#include <sched.h>
 #include "mint.hpp"
 
 bool Task::isMapped(int gN, int mN) {
@@ -98,31 +103,375 @@ void Task::printNodeMap() {
   }
 }
 
-void TaskQueue::setup(std::vector<Edge>& edgeList, std::vector<Edge>& motif) {
-  for (size_t i = 0; i < edgeList.size(); i++) {
-    Task t;
-    t.eG = i;
-    t.eM = 0;
-    t.uG = edgeList.at(i).u;
-    t.vG = edgeList.at(i).v;
-    t.uM = motif.at(0).u;
-    t.vM = motif.at(0).v;
-    t.type = bookkeep;
-    tasks.push(t);
+void CountTable::add(uint64_t key) {
+  pending.push_back(key);
+  // Merge once pending is as large as the table so merging stays linear
+  if (pending.size() >= std::max(keys.size(), (size_t)1 << 16)) seal();
+  return;
+}
+
+void CountTable::seal() {
+  if (pending.empty()) return;
+  std::sort(pending.begin(), pending.end());
+  std::vector<uint64_t> mKeys;
+  std::vector<uint32_t> mCounts;
+  mKeys.reserve(keys.size() + pending.size());
+  mCounts.reserve(keys.size() + pending.size());
+  size_t i = 0;
+  size_t j = 0;
+  while (i < keys.size() || j < pending.size()) {
+    uint64_t key = j == pending.size() || (i < keys.size() &&
+                   keys.at(i) < pending.at(j)) ? keys.at(i) : pending.at(j);
+    uint32_t c = 0;
+    if (i < keys.size() && keys.at(i) == key) c = counts.at(i++);
+    while (j < pending.size() && pending.at(j) == key) {
+      c++;
+      j++;
+    }
+    mKeys.push_back(key);
+    mCounts.push_back(c);
+  }
+  keys.swap(mKeys);
+  counts.swap(mCounts);
+  pending.clear();
+  pending.shrink_to_fit();
+  return;
+}
+
+size_t CountTable::get(uint64_t key) {
+  auto it = std::lower_bound(keys.begin(), keys.end(), key);
+  if (it == keys.end() || *it != key) return 0;
+  return counts.at(it - keys.begin());
+}
+
+void EdgeStore::count(Edge& e) {
+  outTotal.add((uint32_t)e.u);
+  inTotal.add((uint32_t)e.v);
+  pairTotal.add(pairKey(e.u, e.v));
+  total++;
+  counted = true;
+  return;
+}
+
+void EdgeStore::seal() {
+  outTotal.seal();
+  inTotal.seal();
+  pairTotal.seal();
+  return;
+}
+
+void EdgeStore::adopt(EdgeStore& counts) {
+  outTotal = std::move(counts.outTotal);
+  inTotal = std::move(counts.inTotal);
+  pairTotal = std::move(counts.pairTotal);
+  total = counts.total;
+  partial = false;
+  return;
+}
+
+void EdgeStore::append(Edge& e) {
+  edges.push_back(e);
+  if (partial) total = loaded();
+  return;
+}
+
+void EdgeStore::evict(size_t to) {
+  if (to <= base) return;
+  for (size_t i = base; i < to; i++) {
+    outBefore.add((uint32_t)at(i).u);
+    inBefore.add((uint32_t)at(i).v);
+    pairBefore.add(pairKey(at(i).u, at(i).v));
+  }
+  outBefore.seal();
+  inBefore.seal();
+  pairBefore.seal();
+  edges.erase(edges.begin(), edges.begin() + (to - base));
+  base = to;
+  return;
+}
+
+void EdgeStore::mirror(EdgeStore& from) {
+  if (counted != from.counted || partial != from.partial ||
+      (!partial && total != from.total)) {
+    *this = from;
+    return;
+  }
+  if (base != from.base) {
+    size_t drop = std::min(from.base - base, edges.size());
+    edges.erase(edges.begin(), edges.begin() + drop);
+    base = from.base;
+    outBefore = from.outBefore;
+    inBefore = from.inBefore;
+    pairBefore = from.pairBefore;
+  }
+  edges.insert(edges.end(), from.edges.begin() + (loaded() - from.base),
+               from.edges.end());
+  total = from.total;
+  return;
+}
+
+size_t EdgeStore::before(bool uCheck, bool vCheck, int uG, int vG) {
+  if (!counted) return 0;
+  // Only reads here, search engines on other threads share these tables
+  if (uCheck && vCheck) return pairBefore.get(pairKey(uG, vG));
+  if (uCheck) return outBefore.get((uint32_t)uG);
+  if (vCheck) return inBefore.get((uint32_t)vG);
+  return base;
+}
+
+size_t EdgeStore::matches(bool uCheck, bool vCheck, int uG, int vG) {
+  if (uCheck && vCheck) return pairTotal.get(pairKey(uG, vG));
+  if (uCheck) return outTotal.get((uint32_t)uG);
+  if (vCheck) return inTotal.get((uint32_t)vG);
+  return total;
+}
+
+size_t EdgeStore::after(bool uCheck, bool vCheck, int uG, int vG,
+                        size_t resident) {
+  if (!counted) return 0;
+  return matches(uCheck, vCheck, uG, vG) - before(uCheck, vCheck, uG, vG) -
+      resident;
+}
+
+void TaskQueue::setup(EdgeStore& edgeList, std::vector<Edge>& motif,
+                      size_t from, size_t to) {
+  for (size_t i = from; i < to; i++) {
+    tasks.push(root(edgeList, motif, i));
   }
   if (VERBOSE) std::cout << "Pushed " << tasks.size() << " root tasks" <<
                    std::endl;
   return;
 }
 
+Task TaskQueue::root(EdgeStore& edgeList, std::vector<Edge>& motif,
+                     size_t i) {
+  Task t;
+  t.eG = i;
+  t.eM = 0;
+  t.uG = edgeList.at(i).u;
+  t.vG = edgeList.at(i).v;
+  t.uM = motif.at(0).u;
+  t.vM = motif.at(0).v;
+  t.type = bookkeep;
+  return t;
+}
+
 void MappingStore::addResult(ContextMem& cMem) {
 #pragma omp critical
   store.push_back(cMem.nodeMap);
   return;
 }
 
+void MappingStore::addResults(std::vector<std::vector<Mapping>>& found) {
+#pragma omp critical
+  store.insert(store.end(), found.begin(), found.end());
+  return;
+}
+
+void DramDemand::spread(double n, size_t start, size_t end) {
+  if (n <= 0) return;
+  if (end <= start) end = start + 1;
+  // Split at DRAM_EPOCH whatever the bin width, so the fixed point share of
+  // each epoch is the same however coarse the bins have become
+  uint64_t left = (uint64_t)std::llround(n*(1 << 16));
+  for (size_t e = start/DRAM_EPOCH; e <= (end - 1)/DRAM_EPOCH; e++) {
+    size_t from = std::max(start, e*DRAM_EPOCH);
+    size_t to = std::min(end, (e + 1)*DRAM_EPOCH);
+    uint64_t part = to == end ? left : left*(to - from)/(end - from);
+    left -= part;
+    while ((e >> width) >= DRAM_BINS) coarsen(width + 1);
+    if (bins.size() <= (e >> width)) bins.resize((e >> width) + 1, 0);
+    bins.at(e >> width) += part;
+  }
+  return;
+}
+
+void DramDemand::coarsen(size_t w) {
+  for (; width < w; width++) {
+    for (size_t b = 0; b < bins.size(); b++) {
+      bins.at(b/2) = b % 2 == 0 ? bins.at(b) : bins.at(b/2) + bins.at(b);
+    }
+    bins.resize((bins.size() + 1)/2);
+  }
+  return;
+}
+
+void DramModel::spread(double n, size_t start, size_t end) {
+  threads.at(omp_get_thread_num()).spread(n, start, end);
+  return;
+}
+
+void DramModel::solve() {
+  for (size_t t = 0; t < threads.size(); t++) {
+    total.coarsen(threads.at(t).width);
+  }
+  for (size_t t = 0; t < threads.size(); t++) {
+    DramDemand& d = threads.at(t);
+    d.coarsen(total.width);
+    if (total.bins.size() < d.bins.size()) total.bins.resize(d.bins.size(), 0);
+    for (size_t b = 0; b < d.bins.size(); b++) {
+      total.bins.at(b) += d.bins.at(b);
+    }
+    d.bins.clear();
+    d.bins.shrink_to_fit();
+  }
+  epoch = (size_t)DRAM_EPOCH << total.width;
+  // Lines all channels can move in one epoch, and cycles one channel takes
+  // to move one line
+  double capacity = (double)epoch*DRAM_CHANNELS*DRAM_BW/LINE_SIZE;
+  double service = (double)LINE_SIZE/DRAM_BW;
+  demand.assign(total.bins.size(), 0);
+  delay.assign(demand.size(), 0);
+  shift.assign(demand.size() + 1, 0);
+  waited.assign(demand.size() + 1, 0);
+  moved.assign(demand.size() + 1, 0);
+  for (size_t e = 0; e < demand.size(); e++) {
+    demand.at(e) = (double)total.bins.at(e)/(1 << 16);
+    lines += demand.at(e);
+    double util = demand.at(e)/capacity;
+    double extra = 0;
+    if (util >= DRAM_MAX_UTIL) {
+      // The epoch lasts until the channels have moved all of its lines
+      saturated++;
+      extra = epoch*(util/DRAM_MAX_UTIL - 1);
+      util = DRAM_MAX_UTIL;
+    }
+    // M/D/1 wait of random arrivals at this epoch's load
+    delay.at(e) = service*util/(2*(1 - util));
+    shift.at(e + 1) = shift.at(e) + extra;
+    waited.at(e + 1) = waited.at(e) + demand.at(e)*delay.at(e);
+    moved.at(e + 1) = moved.at(e) + demand.at(e);
+    queued += demand.at(e)*(delay.at(e) + extra/2);
+  }
+  return;
+}
+
+double DramModel::charge(double n, size_t end) {
+  // Prefix sums up to end, taking the share of the epoch end falls in
+  size_t e = std::min(end/epoch, demand.size());
+  double frac = e < demand.size() ? (double)(end - e*epoch)/epoch : 0;
+  double stretch = shift.at(e);
+  double wait = waited.at(e);
+  double all = moved.at(e);
+  if (e < demand.size()) {
+    stretch += (shift.at(e + 1) - shift.at(e))*frac;
+    wait += (waited.at(e + 1) - waited.at(e))*frac;
+    all += demand.at(e)*frac;
+  }
+  // The CU's own transfers wait the average delay of the epochs it ran
+  // through, and every CU still running through a saturated epoch is
+  // stretched with it
+  return (all > 0 ? n*wait/all : 0) + stretch;
+}
+
+void NumaMap::detect() {
+  for (size_t n = 0; ; n++) {
+    std::ifstream in("/sys/devices/system/node/node" + std::to_string(n) +
+                     "/cpulist");
+    if (!in.is_open()) break;
+    // Ranges such as 0-3,8-11
+    std::vector<int> list;
+    std::string range;
+    while (std::getline(in, range, ',')) {
+      size_t dash = range.find('-');
+      int lo = std::stoi(range);
+      int hi = (dash == std::string::npos) ? lo : std::stoi(range.substr(dash + 1));
+      for (int c = lo; c <= hi; c++) list.push_back(c);
+    }
+    cpus.push_back(list);
+  }
+  if (cpus.empty()) {
+    cpus.push_back(std::vector<int>());
+    for (int c = 0; c < (int)std::thread::hardware_concurrency(); c++) {
+      cpus.back().push_back(c);
+    }
+  }
+  if (NUMA_NODES > 0 && NUMA_NODES < cpus.size()) {
+    // Run on the first nodes only, e.g. one socket to compare against two
+    cpus.resize(NUMA_NODES);
+  } else if (NUMA_NODES > 0 && cpus.size() != NUMA_NODES) {
+    std::vector<int> all;
+    for (size_t i = 0; i < cpus.size(); i++) {
+      all.insert(all.end(), cpus.at(i).begin(), cpus.at(i).end());
+    }
+    cpus.assign(NUMA_NODES, std::vector<int>());
+    for (size_t i = 0; i < all.size(); i++) {
+      cpus.at(i*NUMA_NODES/all.size()).push_back(all.at(i));
+    }
+  }
+  return;
+}
+
+void NumaMap::limit(size_t n) {
+  if (n == 0 || cpus.size() <= n) return;
+  for (size_t i = n; i < cpus.size(); i++) {
+    cpus.at(i % n).insert(cpus.at(i % n).end(), cpus.at(i).begin(),
+                          cpus.at(i).end());
+  }
+  cpus.resize(n);
+  return;
+}
+
+void NumaMap::pin(size_t node, size_t index) {
+  if (cpus.at(node).empty()) return;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpus.at(node).at(index % cpus.at(node).size()), &set);
+  if (sched_setaffinity(0, sizeof(set), &set) != 0 && VERBOSE) {
+    std::cerr << "Warning: could not pin host thread to node " << node <<
+        std::endl;
+  }
+  return;
+}
+
+void TraceBuffer::sample(size_t eG) {
+  sampled = (eG % TRACE_SAMPLE == 0);
+  root = eG;
+  return;
+}
+
+void TraceBuffer::record(const char* name, size_t start, size_t end) {
+  if (!sampled || end < TRACE_BEGIN || start > TRACE_END) return;
+  push(TraceEvent{name, 'X', start, end - start, root});
+  return;
+}
+
+void TraceBuffer::mark(const char* name, size_t at) {
+  if (!sampled || at < TRACE_BEGIN || at > TRACE_END) return;
+  push(TraceEvent{name, 'i', at, 0, root});
+  return;
+}
+
+void TraceBuffer::push(TraceEvent e) {
+  if (events.size() < TRACE_BUF_SIZE) {
+    events.push_back(e);
+  } else {
+    events.at(head) = e;
+    head = (head + 1) % TRACE_BUF_SIZE;
+    dropped++;
+  }
+  return;
+}
+
+void TraceBuffer::write(std::ostream& out, size_t tid, bool& first) {
+  for (size_t i = 0; i < events.size(); i++) {
+    TraceEvent& e = events.at((head + i) % events.size());
+    out << (first ? "\n" : ",\n") << "{\"name\":\"" << e.name <<
+        "\",\"ph\":\"" << e.phase << "\",\"ts\":" << e.ts;
+    if (e.phase == 'X') {
+      out << ",\"dur\":" << e.dur;
+    } else {
+      out << ",\"s\":\"t\"";
+    }
+    out << ",\"pid\":0,\"tid\":" << tid << ",\"args\":{\"root\":" << e.root <<
+        "}}";
+    first = false;
+  }
+  return;
+}
+
 MgrStatus ContextMgr::updateContext(Task& task) {
-  MgrStatus status;
+  MgrStatus status = dispatch;
   cMem.busy = true;
   cMem.eG = task.eG;
   cMem.eM = task.eM;
@@ -137,7 +486,7 @@ MgrStatus ContextMgr::updateContext(Task& task) {
         cMem.nodeMap = task.nodeMap;
         results.addResult(cMem);
         cycles += CMEM_LATENCY*3*task.nodeMap.size();
-        cycles += DRAM_LATENCY*3*task.nodeMap.size();
+        mem.dram(3*task.nodeMap.size());
       } else {
         if (VERBOSE) std::cout << "Bookkeeping mapped edge " << task.eG <<
                          std::endl;
@@ -146,14 +495,16 @@ MgrStatus ContextMgr::updateContext(Task& task) {
         cMem.vG = edgeList.at(task.eG).v;
         cMem.uM = task.uM;
         cMem.vM = task.vM;
-        cycles += CMEM_LATENCY*4 + CACHE_EXP*2;
+        cycles += CMEM_LATENCY*4;
+        mem.cache(2);
         task.insertMapping(cMem.uG, cMem.uM, cycles);
         task.insertMapping(cMem.vG, cMem.vM, cycles);
         cMem.nodeMap = task.nodeMap;
         cycles += JMP_LATENCY;
         if (cMem.eStack.empty()) {
           cMem.time = edgeList.at(task.eG).time + motifTime;
-          cycles += CMEM_LATENCY + ADD_LATENCY + CACHE_EXP;
+          cycles += CMEM_LATENCY + ADD_LATENCY;
+          mem.cache(1);
           if (VVERBOSE) std::cout << "Set time bound: " << cMem.time <<
                            std::endl;
         }
@@ -172,7 +523,8 @@ MgrStatus ContextMgr::updateContext(Task& task) {
       cycles += CMEM_LATENCY + ADD_LATENCY;
       if (VVERBOSE) std::cout << "New eG is " << cMem.eG << std::endl;
       while (cMem.eG >= edgeList.size() || edgeList.at(cMem.eG).time > cMem.time) {
-        cycles += JMP_LATENCY*2 + CMEM_LATENCY*2 + CACHE_EXP;
+        cycles += JMP_LATENCY*2 + CMEM_LATENCY*2;
+        mem.cache(1);
         if (!(cMem.eStack.size() == 1)) {
           status = dispatch;
           cMem.eG = cMem.eStack.top() + 1;
@@ -268,26 +620,43 @@ std::vector<size_t> SearchEng::searchPhaseOne(Task& task) {
   bool uCheck = (task.uG >= 0);
   bool vCheck = (task.vG >= 0);
   cycles += MOV_LATENCY*2;
-  for (size_t i = 0; i < edgeList.size(); i++) {
+  // Only the resident edges are scanned, the rest are accounted for by count
+  for (size_t i = edgeList.base; i < edgeList.loaded(); i++) {
     if ((!uCheck || edgeList.at(i).u == task.uG)
         && (!vCheck || edgeList.at(i).v == task.vG)) {
       fEdges.push_back(i);
     }
   }
-  // Linear search in parallel, accrue latency once per cache line
-  cycles += (CACHE_EXP*2 + JMP_LATENCY*2 + MOV_LATENCY + ADD_LATENCY)*(edgeList.size()/8);
+  // Linear search in parallel, accrue latency once per cache line. While the
+  // graph is partial this is charged by settle() instead
+  if (!edgeList.partial) {
+    cycles += (JMP_LATENCY*2 + MOV_LATENCY + ADD_LATENCY)*(edgeList.size()/8);
+    mem.cache(2*(edgeList.size()/8));
+  }
   std::vector<size_t> fEdges2;
   if (VVERBOSE) std::cout << "Adjacency filtering gives " << fEdges.size() <<
                    " edges" << std::endl;
-  bool recorded = false;
-  for (size_t i = memo.getStart(uCheck, vCheck, task.uG, task.vG, task.eG, fEdges.size(), cycles);
-       i < fEdges.size(); i++) {
+  for (size_t i = 0; i < fEdges.size(); i++) {
     if (fEdges.at(i) >= task.eG) {
       fEdges2.push_back(fEdges.at(i));
     }
-    memo.record(uCheck, vCheck, task.uG, task.vG, root_eG, fEdges.at(i), i,
-                recorded, fEdges.size(), cycles);
-    cycles += JMP_LATENCY*2 + MOV_LATENCY + CACHE_EXP + ADD_LATENCY;
+  }
+  size_t before = edgeList.before(uCheck, vCheck, task.uG, task.vG);
+  unloaded = 0;
+  if (!edgeList.partial) {
+    unloaded = edgeList.after(uCheck, vCheck, task.uG, task.vG, fEdges.size());
+  }
+  MemoQuery q{uCheck, vCheck, task.uG, task.vG, task.eG,
+              before + fEdges.size() + unloaded,
+              before + (size_t)(std::ranges::lower_bound(fEdges,
+                                                         (size_t)root_eG) -
+                                fEdges.begin()),
+              root_eG, edgeList.partial};
+  if (deferred != nullptr) {
+    // Charged in search tree order once the split search tree is joined
+    deferred->push_back(q);
+  } else {
+    memoWalk(q);
   }
   if (VVERBOSE) std::cout << "Time order filtering gives " << fEdges2.size() <<
                    " edges" << std::endl;
@@ -300,14 +669,56 @@ std::vector<size_t> SearchEng::searchPhaseOne(Task& task) {
   return fEdges2;
 }
 
+void SearchEng::memoWalk(MemoQuery& q) {
+  if (q.open) {
+    // The edges not loaded yet are only known once the loader has counted
+    // them, so keep the memo updates in search order until then
+    unsettled.push_back(q);
+    return;
+  }
+  bool recorded = false;
+  for (size_t i = memo.getStart(q.uCheck, q.vCheck, q.uG, q.vG, q.eG, q.size, mem);
+       i < q.size; i++) {
+    memo.record(q.uCheck, q.vCheck, q.uG, q.vG, q.root, i >= q.first, i,
+                recorded, q.size, mem);
+    cycles += JMP_LATENCY*2 + MOV_LATENCY + ADD_LATENCY;
+    mem.cache(1);
+  }
+  return;
+}
+
+void SearchEng::settle() {
+  for (size_t i = 0; i < unsettled.size(); i++) {
+    MemoQuery& q = unsettled.at(i);
+    size_t all = edgeList.matches(q.uCheck, q.vCheck, q.uG, q.vG);
+    size_t missed = all - q.size;
+    q.size = all;
+    q.open = false;
+    // The phase one scan, memo walk and phase two checks this search skipped
+    cycles += (JMP_LATENCY*2 + MOV_LATENCY + ADD_LATENCY)*(edgeList.size()/8);
+    mem.cache(2*(edgeList.size()/8));
+    memoWalk(q);
+    cycles += ADD_LATENCY*missed;
+    mem.cache(3*missed);
+    if (q.unmatched) cycles += (JMP_LATENCY*5 + MOV_LATENCY*2)*missed;
+  }
+  unsettled.clear();
+  unsettled.shrink_to_fit();
+  return;
+}
+
 void SearchEng::searchPhaseTwo(Task& task, std::vector<size_t> fEdges) {
   if (VVERBOSE) std::cout << "Beginning search phase two" << std::endl;
   // Fetch full edge data
   std::vector<Edge> fEdgesData;
   for (size_t i = 0; i < fEdges.size(); i++) {
     fEdgesData.push_back(edgeList.at(fEdges.at(i)));
-    cycles += ADD_LATENCY + CACHE_EXP*3;
+    cycles += ADD_LATENCY;
+    mem.cache(3);
   }
+  // Edges not yet streamed in are past the time window and fail the check
+  cycles += ADD_LATENCY*unloaded;
+  mem.cache(3*unloaded);
   for (size_t i = 0; i < fEdgesData.size(); i++) {
     if (fEdgesData.at(i).time <= task.time) {
       if ((task.isMapped(fEdgesData.at(i).u, task.uM)
@@ -322,35 +733,313 @@ void SearchEng::searchPhaseTwo(Task& task, std::vector<size_t> fEdges) {
     }
     cycles += JMP_LATENCY*5 + MOV_LATENCY*2;
   }
+  cycles += (JMP_LATENCY*5 + MOV_LATENCY*2)*unloaded;
+  if (edgeList.partial) {
+    // The edges past the loaded ones would have been checked too
+    (deferred != nullptr ? deferred->back() : unsettled.back()).unmatched = true;
+  }
   if (VVERBOSE) std::cout << "Edge match not found" << std::endl;
   task.eG = edgeList.size();
   task.type = backtrack;
   return;
 }
 
+ComputeUnit::ComputeUnit(MappingStore& r, TargetMotif& t,
+                         EdgeStore& eL, std::vector<ContextMem*> c):
+    results(r), tM(t), edgeList(eL) {
+  for (size_t i = 0; i < c.size(); i++) {
+    contexts.push_back(new HwContext(results, tM, edgeList, *(c.at(i)), memo));
+  }
+}
+
+ComputeUnit::~ComputeUnit() {
+  for (size_t i = 0; i < contexts.size(); i++) {
+    delete contexts.at(i);
+  }
+}
+
 void ComputeUnit::executeRootTask(Task t) {
+  HwContext* ctx = nullptr;
+  for (size_t i = 0; i < contexts.size() && ctx == nullptr; i++) {
+    if (!contexts.at(i)->active) ctx = contexts.at(i);
+  }
+  if (ctx == nullptr) {
+    std::cerr << "Error: no free hardware context for root task" << std::endl;
+    throw "No free context";
+  }
+  ctx->task = t;
+  ctx->active = true;
+  ctx->ready += DEQUEUE_LATENCY;
+  ctx->rootStart = ctx->ready;
+  ctx->nodes = 0;
+  ctx->sEng.root_eG = t.eG;
+  if (TRACE) ctx->trace.sample(t.eG);
+  cycles = std::max(cycles, ctx->ready);
+  if (std::ranges::all_of(contexts, [](HwContext* c) { return c->active; })) {
+    advance();
+  }
+  return;
+}
+
+void ComputeUnit::drain() {
+  while (std::ranges::any_of(contexts, [](HwContext* c) { return c->active; })) {
+    advance();
+  }
+  return;
+}
+
+void ComputeUnit::settle() {
+  for (size_t i = 0; i < contexts.size(); i++) {
+    HwContext* ctx = contexts.at(i);
+    size_t startCycles = ctx->cycles;
+    size_t startStalls = ctx->mem.stalls;
+    ctx->sEng.settle();
+    size_t taken = ctx->cycles - startCycles;
+    size_t stalled = ctx->mem.stalls - startStalls;
+    // As if each search had been charged in full when it was made
+    engine += taken - stalled;
+    busy += taken - stalled;
+    ctx->ready += taken;
+    cycles = std::max(cycles, ctx->ready);
+  }
+  return;
+}
+
+void ComputeUnit::advance() {
   bool working = true;
-  sEng.root_eG = t.eG;
   while (working) {
-    MgrStatus mStatus;
-    if (VVERBOSE) std::cout << "Updating context" << std::endl;
-    cycles += TASK_LATENCY;
-    mStatus = cMgr.updateContext(t);
-    switch (mStatus) {
-      case end:
-        if (VVERBOSE) std::cout << "Manager status: end" << std::endl;
-        working = false;
-        break;
+    HwContext* ctx = nullptr;
+    for (size_t i = 0; i < contexts.size(); i++) {
+      if (contexts.at(i)->active &&
+          (ctx == nullptr || contexts.at(i)->ready < ctx->ready)) {
+        ctx = contexts.at(i);
+      }
+    }
+    if (ctx == nullptr) return;
+    size_t base = std::max(ctx->ready, engine);
+    size_t startCycles = ctx->cycles;
+    size_t startStalls = ctx->mem.stalls;
+    double startLines = ctx->mem.lines;
+    if (HOST_SPLIT && NUM_CONTEXTS == 1 && ctx->nodes >= SPLIT_THRESH) {
+      ctx->stepBase = base;
+      ctx->stepCycles = ctx->cycles;
+      splitRoot(*ctx);
+      working = false;
+    } else {
+      working = step(*ctx, base);
+    }
+    ctx->nodes++;
+    steps++;
+    size_t taken = ctx->cycles - startCycles;
+    size_t stalled = ctx->mem.stalls - startStalls;
+    // Shared components are held for the step, the memory stalls are not
+    engine = base + taken - stalled;
+    busy += taken - stalled;
+    ctx->ready = base + taken;
+    cycles = std::max(cycles, ctx->ready);
+    if (DRAM_MODEL) {
+      dram->spread(ctx->mem.lines - startLines, base, ctx->ready);
+      lines += ctx->mem.lines - startLines;
+    }
+    if (!working) {
+      ctx->active = false;
+      if (TRACE) ctx->trace.record("root task", ctx->rootStart, ctx->ready);
+    }
+  }
+  return;
+}
+
+bool ComputeUnit::step(HwContext& ctx, size_t base) {
+  bool working = true;
+  ctx.stepBase = base;
+  ctx.stepCycles = ctx.cycles;
+  switch (update(ctx)) {
+    case end:
+      if (VVERBOSE) std::cout << "Manager status: end" << std::endl;
+      working = false;
+      break;
+    case dispatch:
+      if (VVERBOSE) std::cout << "Manager status: dispatch" << std::endl;
+      search(ctx);
+      break;
+    case remanage:
+      if (VVERBOSE) std::cout << "Manager status: remanage" << std::endl;
+      if (TRACE) ctx.trace.mark("match", ctx.now());
+      ctx.task.type = backtrack;
+      break;
+    default:
+      std::cerr << "Error: unrecognized Context Manager status code" <<
+          std::endl;
+  }
+  return working;
+}
+
+MgrStatus ComputeUnit::update(HwContext& ctx) {
+  if (VVERBOSE) std::cout << "Updating context" << std::endl;
+  ctx.cycles += TASK_LATENCY;
+  size_t start = ctx.now();
+  const char* update = (ctx.task.type == backtrack) ? "backtrack" : "update";
+  MgrStatus mStatus = ctx.cMgr.updateContext(ctx.task);
+  if (TRACE) ctx.trace.record(update, start, ctx.now());
+  return mStatus;
+}
+
+void ComputeUnit::search(HwContext& ctx) {
+  size_t start = ctx.now();
+  ctx.disp.dispatch(ctx.task);
+  if (TRACE) ctx.trace.record("dispatch", start, ctx.now());
+  if (VERBOSE) std::cout << "Beginning search" << std::endl;
+  ctx.cycles += TASK_LATENCY;
+  start = ctx.now();
+  size_t memoHits = memo.hits;
+  std::vector<size_t> fEdges = ctx.sEng.searchPhaseOne(ctx.task);
+  if (TRACE) {
+    ctx.trace.record("searchPhaseOne", start, ctx.now());
+    if (memo.hits != memoHits) ctx.trace.mark("memo hit", ctx.now());
+  }
+  start = ctx.now();
+  ctx.sEng.searchPhaseTwo(ctx.task, fEdges);
+  if (TRACE) ctx.trace.record("searchPhaseTwo", start, ctx.now());
+  return;
+}
+
+bool ComputeUnit::pops(HwContext& ctx) {
+  size_t next = ctx.task.eG + 1;
+  return next >= edgeList.size() || edgeList.at(next).time > ctx.cMem.time;
+}
+
+SplitPart::SplitPart(TargetMotif& t, EdgeStore& eL, MemoStruct& m,
+                     HwContext& from, size_t d):
+    cMem(from.cMem), ctx(results, t, eL, cMem, m), depth(d) {
+  ctx.task = from.task;
+  ctx.cMgr.motifSize = from.cMgr.motifSize;
+  ctx.cMgr.motifTime = from.cMgr.motifTime;
+  ctx.sEng.root_eG = from.sEng.root_eG;
+  ctx.sEng.deferred = &queries;
+}
+
+SplitPart::~SplitPart() {
+  for (size_t i = 0; i < children.size(); i++) {
+    delete children.at(i);
+  }
+}
+
+bool SplitPart::closedAsPredicted() {
+  if (status != dispatch || cMem.eStack != predicted.eStack ||
+      cMem.eG != predicted.eG || cMem.eM != predicted.eM ||
+      cMem.time != predicted.time ||
+      cMem.nodeMap.size() != predicted.nodeMap.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < cMem.nodeMap.size(); i++) {
+    if (cMem.nodeMap.at(i).mNode != predicted.nodeMap.at(i).mNode ||
+        cMem.nodeMap.at(i).gNode != predicted.nodeMap.at(i).gNode ||
+        cMem.nodeMap.at(i).count != predicted.nodeMap.at(i).count) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void ComputeUnit::splitRoot(HwContext& ctx) {
+  if (VERBOSE) std::cout << "Splitting search tree of root task " <<
+                   ctx.sEng.root_eG << std::endl;
+  if (TRACE) ctx.trace.mark("host split", ctx.now());
+  std::vector<std::vector<Mapping>> found;
+  MgrStatus status = dispatch;
+  bool updated = false;
+  // Close the edges on the current path one level at a time
+  while (status != end) {
+    SplitPart part(tM, edgeList, memo, ctx, ctx.cMem.eStack.size());
+    part.status = status;
+    part.flushTo = &ctx;
+    explore(part, updated);
+    collect(ctx, part, found);
+    ctx.cMem = part.cMem;
+    ctx.task = part.ctx.task;
+    status = part.status;
+    updated = true;
+  }
+  results.addResults(found);
+  return;
+}
+
+void ComputeUnit::explore(SplitPart& part, bool updated) {
+  HwContext& ctx = part.ctx;
+  while (true) {
+    if (!updated) {
+      if (ctx.task.type == backtrack && pops(ctx)) {
+        if (join(part)) {
+          updated = true;
+          continue;
+        }
+        // The popped edges are removed using the last pushed edge, which the
+        // last child saw
+        if (!part.children.empty()) {
+          SplitPart* last = part.children.back();
+          ctx.cMem.uG = last->cMem.uG;
+          ctx.cMem.vG = last->cMem.vG;
+          ctx.cMem.uM = last->cMem.uM;
+          ctx.cMem.vM = last->cMem.vM;
+        } else if (part.flushed) {
+          ctx.cMem.uG = part.lastUG;
+          ctx.cMem.vG = part.lastVG;
+          ctx.cMem.uM = part.lastUM;
+          ctx.cMem.vM = part.lastVM;
+        }
+      }
+      size_t depth = ctx.cMem.eStack.size();
+      std::vector<Mapping> nodeMap = ctx.cMem.nodeMap;
+      part.status = update(ctx);
+      if (part.status == dispatch && ctx.cMem.eStack.size() > depth &&
+          ctx.cMem.eStack.size() <= SPLIT_DEPTH) {
+        SplitPart* child = new SplitPart(tM, edgeList, memo, ctx,
+                                         ctx.cMem.eStack.size());
+        part.marks.push_back(SplitMark{part.queries.size(),
+                                       part.results.store.size(), ctx.cycles,
+                                       ctx.mem.stalls, ctx.mem.lines});
+        part.children.push_back(child);
+        size_t next = ctx.cMem.eG;
+        if (next < edgeList.size() && edgeList.at(next).time <= ctx.cMem.time) {
+          // Carry on as if the child had popped its edge and restored the
+          // node map
+          child->speculated = true;
+          ctx.cMem.eStack.pop();
+          ctx.cMem.eM--;
+          ctx.cMem.nodeMap = nodeMap;
+          child->predicted = ctx.cMem;
+#pragma omp task firstprivate(child)
+          explore(*child, true);
+          // Bound the subtrees the outermost part holds on to
+          if (part.flushTo != nullptr &&
+              part.children.size() - part.joined >= SPLIT_PENDING &&
+              join(part)) {
+            updated = true;
+            continue;
+          }
+        } else {
+          // The child's last backtrack also pops the edge of this part
+          explore(*child, true);
+          // Joining can flush, and so free, the child
+          ContextMem cMem = child->cMem;
+          Task task = child->ctx.task;
+          MgrStatus status = child->status;
+          if (!join(part)) {
+            ctx.cMem = cMem;
+            ctx.task = task;
+            part.status = status;
+          }
+        }
+      }
+    }
+    updated = false;
+    if (part.closed()) break;
+    switch (part.status) {
       case dispatch:
-        if (VVERBOSE) std::cout << "Manager status: dispatch" << std::endl;
-        disp.dispatch(t);
-        if (VERBOSE) std::cout << "Beginning search" << std::endl;
-        cycles += TASK_LATENCY;
-        sEng.searchPhaseTwo(t, sEng.searchPhaseOne(t));
+        search(ctx);
         break;
       case remanage:
-        if (VVERBOSE) std::cout << "Manager status: remanage" << std::endl;
-        t.type = backtrack;
+        ctx.task.type = backtrack;
         break;
       default:
         std::cerr << "Error: unrecognized Context Manager status code" <<
@@ -360,19 +1049,279 @@ void ComputeUnit::executeRootTask(Task t) {
   return;
 }
 
-Mint::Mint(TargetMotif m, std::vector<Edge> e) {
+bool ComputeUnit::join(SplitPart& part) {
+#pragma omp taskwait
+  for (size_t i = part.joined; i < part.children.size(); i++) {
+    SplitPart* child = part.children.at(i);
+    if (child->speculated && !child->closedAsPredicted()) {
+      if (VERBOSE) std::cout << "Split subtree left an unexpected context, " <<
+                       "rolling back" << std::endl;
+      // Everything after this child was explored from the wrong state
+      for (size_t j = i + 1; j < part.children.size(); j++) {
+        delete part.children.at(j);
+      }
+      part.children.resize(i + 1);
+      part.marks.resize(i + 1);
+      part.queries.resize(part.marks.at(i).query);
+      part.results.store.resize(part.marks.at(i).result);
+      part.ctx.cycles = part.marks.at(i).cycles;
+      part.ctx.mem.stalls = part.marks.at(i).stalls;
+      part.ctx.mem.lines = part.marks.at(i).lines;
+      part.cMem = child->cMem;
+      part.ctx.task = child->ctx.task;
+      part.status = child->status;
+      part.joined = i + 1;
+      if (part.flushTo != nullptr) flush(part);
+      return true;
+    }
+  }
+  part.joined = part.children.size();
+  if (part.flushTo != nullptr) flush(part);
+  return false;
+}
+
+void ComputeUnit::flush(SplitPart& part) {
+  if (part.joined == 0) return;
+  // Joined children can no longer be rolled back, so they and the part's
+  // work before the last of them are final
+  std::vector<std::vector<Mapping>> found;
+  size_t q = 0;
+  size_t r = 0;
+  for (size_t i = 0; i < part.joined; i++) {
+    for (; q < part.marks.at(i).query; q++) {
+      part.flushTo->sEng.memoWalk(part.queries.at(q));
+    }
+    for (; r < part.marks.at(i).result; r++) {
+      found.push_back(part.results.store.at(r));
+    }
+    collect(*part.flushTo, *(part.children.at(i)), found);
+  }
+  // Later children, if any, replace these as the last one seen
+  SplitPart* last = part.children.at(part.joined - 1);
+  part.flushed = true;
+  part.lastUG = last->cMem.uG;
+  part.lastVG = last->cMem.vG;
+  part.lastUM = last->cMem.uM;
+  part.lastVM = last->cMem.vM;
+  for (size_t i = 0; i < part.joined; i++) {
+    delete part.children.at(i);
+  }
+  results.addResults(found);
+  part.queries.erase(part.queries.begin(), part.queries.begin() + q);
+  part.results.store.erase(part.results.store.begin(),
+                           part.results.store.begin() + r);
+  part.children.erase(part.children.begin(),
+                      part.children.begin() + part.joined);
+  part.marks.erase(part.marks.begin(), part.marks.begin() + part.joined);
+  for (size_t i = 0; i < part.marks.size(); i++) {
+    part.marks.at(i).query -= q;
+    part.marks.at(i).result -= r;
+  }
+  part.joined = 0;
+  return;
+}
+
+void ComputeUnit::collect(HwContext& ctx, SplitPart& part,
+                          std::vector<std::vector<Mapping>>& found) {
+  ctx.cycles += part.ctx.cycles;
+  ctx.mem.stalls += part.ctx.mem.stalls;
+  ctx.mem.lines += part.ctx.mem.lines;
+  size_t q = 0;
+  size_t r = 0;
+  for (size_t i = 0; i <= part.children.size(); i++) {
+    size_t qEnd = part.queries.size();
+    size_t rEnd = part.results.store.size();
+    if (i < part.children.size()) {
+      qEnd = part.marks.at(i).query;
+      rEnd = part.marks.at(i).result;
+    }
+    for (; q < qEnd; q++) {
+      ctx.sEng.memoWalk(part.queries.at(q));
+    }
+    for (; r < rEnd; r++) {
+      found.push_back(part.results.store.at(r));
+    }
+    if (i < part.children.size()) {
+      collect(ctx, *(part.children.at(i)), found);
+    }
+  }
+  return;
+}
+
+Mint::Mint(TargetMotif m, EdgeStore e, MintConfig c) {
+  config = c;
   tM = m;
-  edgeList = e;
+  edgeList = std::move(e);
   tM.time = tM.motif.back().time - tM.motif.front().time;
   if (VERBOSE) std::cout << "Target motif is " << tM.motif.size() <<
                    " edges and " << tM.time << " timesteps long" << std::endl;
-  for (size_t i = 0; i < NUM_CUS; i++) {
-    cMems.push_back(new ContextMem());
-    cUnits.push_back(new ComputeUnit(results, tM, edgeList, *(cMems.back())));
-    cUnits.back()->cMgr.motifSize = tM.motif.size();
-    cUnits.back()->cMgr.motifTime = tM.time;
+  cUnits.resize(config.numCUs, nullptr);
+  cMems.resize(config.numCUs*NUM_CONTEXTS, nullptr);
+  if (DRAM_MODEL) dram.threads.resize(omp_get_max_threads());
+  if (!NUMA) {
+    for (size_t i = 0; i < config.numCUs; i++) {
+      buildUnit(i, edgeList);
+    }
+    return;
+  }
+  numa.detect();
+  numa.limit(omp_get_max_threads());
+  replicas.resize(numa.nodes(), nullptr);
+  nodeRoots.assign(numa.nodes(), 0);
+  nodeSteps.assign(numa.nodes(), 0);
+  nodeSeconds.assign(numa.nodes(), 0);
+  // First touch by a thread pinned to each node places its edge replica and
+  // the state of its CUs in that node's memory
+  std::vector<size_t> next(numa.nodes(), 0);
+#pragma omp parallel
+  {
+    size_t t = omp_get_thread_num();
+    size_t n = omp_get_num_threads();
+    size_t node = numa.node(t, n);
+    numa.pin(node, t - numa.first(node, n));
+    for (size_t k = 0; k < numa.nodes(); k++) {
+      if (numa.lead(k, n) == t) {
+        replicas.at(k) = new EdgeStore();
+        replicas.at(k)->mirror(edgeList);
+      }
+    }
+#pragma omp barrier
+    size_t cu;
+    while (nextUnit(next, t, n, cu)) {
+      buildUnit(cu, *replicas.at(unitNode(cu)));
+    }
+  }
+  if (!edgeList.counted) {
+    // Loaded whole, so the replicas already hold every edge there will be.
+    // Keep only the size rather than one more copy of the graph
+    edgeList.edges.clear();
+    edgeList.edges.shrink_to_fit();
+    edgeList.base = edgeList.total;
+  }
+}
+
+Mint::~Mint() {
+  for (size_t i = 0; i < cUnits.size(); i++) {
+    delete cUnits.at(i);
+  }
+  for (size_t i = 0; i < cMems.size(); i++) {
+    delete cMems.at(i);
+  }
+  for (size_t i = 0; i < replicas.size(); i++) {
+    delete replicas.at(i);
+  }
+}
+
+void Mint::buildUnit(size_t i, EdgeStore& eL) {
+  std::vector<ContextMem*> unitMems;
+  for (size_t j = 0; j < NUM_CONTEXTS; j++) {
+    cMems.at(i*NUM_CONTEXTS + j) = new ContextMem();
+    unitMems.push_back(cMems.at(i*NUM_CONTEXTS + j));
+  }
+  cUnits.at(i) = new ComputeUnit(results, tM, eL, unitMems);
+  cUnits.at(i)->memo.enabled = config.useMemo;
+  cUnits.at(i)->memo.thresh = config.memoThresh;
+  cUnits.at(i)->dram = &dram;
+  for (size_t j = 0; j < NUM_CONTEXTS; j++) {
+    cUnits.at(i)->contexts.at(j)->cMgr.motifSize = tM.motif.size();
+    cUnits.at(i)->contexts.at(j)->cMgr.motifTime = tM.time;
+  }
+  return;
+}
+
+bool Mint::nextUnit(std::vector<size_t>& next, size_t t, size_t n,
+                    size_t& cu) {
+  size_t own = numa.node(t, n);
+  for (size_t i = 0; i <= numa.nodes(); i++) {
+    size_t k = i == 0 ? own : i - 1;
+    if (i > 0 && (k == own || numa.count(k, n) > 0)) continue;
+    size_t j;
+#pragma omp atomic capture
+    j = next.at(k)++;
+    if (firstUnit(k) + j < firstUnit(k + 1)) {
+      cu = firstUnit(k) + j;
+      return true;
+    }
+  }
+  return false;
+}
+
+void Mint::mirror() {
+  if (!edgeList.counted) return;
+#pragma omp parallel
+  {
+    size_t t = omp_get_thread_num();
+    size_t n = omp_get_num_threads();
+    size_t node = numa.node(t, n);
+    numa.pin(node, t - numa.first(node, n));
+    for (size_t k = 0; k < numa.nodes(); k++) {
+      if (numa.lead(k, n) == t) replicas.at(k)->mirror(edgeList);
+    }
+  }
+  return;
+}
+
+void Mint::runLocal(size_t from, size_t to, bool drain) {
+  size_t threads = omp_get_max_threads();
+  std::vector<size_t> roots(threads, 0);
+  std::vector<size_t> steps(threads, 0);
+  std::vector<double> spent(threads, 0);
+  std::vector<size_t> next(numa.nodes(), 0);
+  size_t team = 0;
+#pragma omp parallel
+  {
+    size_t t = omp_get_thread_num();
+    size_t n = omp_get_num_threads();
+    size_t node = numa.node(t, n);
+    numa.pin(node, t - numa.first(node, n));
+    double start = omp_get_wtime();
+    // A long root only holds up its own CU, the node's other threads carry
+    // on with the remaining CUs
+    size_t cu;
+    while (nextUnit(next, t, n, cu)) {
+      size_t before = cUnits.at(cu)->steps;
+      size_t i = from + (cu + config.numCUs - from % config.numCUs) %
+          config.numCUs;
+      for (; i < to; i += config.numCUs) {
+        Task task = tQ.root(*replicas.at(unitNode(cu)), tM.motif, i);
+        cUnits.at(cu)->executeRootTask(task);
+        roots.at(t)++;
+      }
+      if (drain) cUnits.at(cu)->drain();
+      steps.at(t) += cUnits.at(cu)->steps - before;
+    }
+    spent.at(t) = omp_get_wtime() - start;
+    if (t == 0) team = n;
   }
-  tQ.setup(edgeList, tM.motif);  
+  // A node is busy until its slowest thread is done
+  std::vector<double> longest(numa.nodes(), 0);
+  for (size_t t = 0; t < team; t++) {
+    size_t node = numa.node(t, team);
+    nodeRoots.at(node) += roots.at(t);
+    nodeSteps.at(node) += steps.at(t);
+    longest.at(node) = std::max(longest.at(node), spent.at(t));
+  }
+  for (size_t k = 0; k < numa.nodes(); k++) {
+    nodeSeconds.at(k) += longest.at(k);
+  }
+  return;
+}
+
+void Mint::printNuma() {
+  size_t steps = 0;
+  double seconds = 0;
+  for (size_t k = 0; k < numa.nodes(); k++) {
+    std::cout << "NUMA node " << k << ": " << nodeRoots.at(k) <<
+        " root tasks, " << nodeSteps.at(k) << " search steps in " <<
+        nodeSeconds.at(k) << " s (" <<
+        (nodeSeconds.at(k) > 0 ? nodeSteps.at(k)/nodeSeconds.at(k) : 0) <<
+        " steps/s)" << std::endl;
+    steps += nodeSteps.at(k);
+    seconds = std::max(seconds, nodeSeconds.at(k));
+  }
+  std::cout << "Host throughput: " << (seconds > 0 ? steps/seconds : 0) <<
+      " steps/s over " << numa.nodes() << " NUMA nodes" << std::endl;
+  return;
 }
 
 void Mint::printResults() {
@@ -388,7 +1337,58 @@ void Mint::printResults() {
   return;
 }
 
+void Mint::writeTrace() {
+  std::ofstream out(TRACE_FILE);
+  if (!out.is_open()) {
+    std::cerr << "Error: could not open trace file " << TRACE_FILE << std::endl;
+    return;
+  }
+  // One simulated cycle is written as one trace microsecond
+  out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+  bool first = true;
+  size_t dropped = 0;
+  for (size_t i = 0; i < config.numCUs; i++) {
+    for (size_t j = 0; j < NUM_CONTEXTS; j++) {
+      TraceBuffer& trace = cUnits.at(i)->contexts.at(j)->trace;
+      if (trace.events.empty()) continue;
+      size_t tid = i*NUM_CONTEXTS + j;
+      out << (first ? "\n" : ",\n") << "{\"name\":\"thread_name\"," <<
+          "\"ph\":\"M\",\"pid\":0,\"tid\":" << tid <<
+          ",\"args\":{\"name\":\"CU " << i;
+      if (NUM_CONTEXTS > 1) out << " context " << j;
+      out << "\"}}";
+      first = false;
+      trace.write(out, tid, first);
+      dropped += trace.dropped;
+    }
+  }
+  out << "\n]}" << std::endl;
+  out.close();
+  std::cout << "Wrote trace to " << TRACE_FILE << std::endl;
+  if (dropped > 0) {
+    std::cout << "Trace ring buffers overwrote " << dropped << " events" <<
+        std::endl;
+  }
+  return;
+}
+
 void Mint::run() {
+  runRoots(0, edgeList.size());
+  finish();
+  return;
+}
+
+void Mint::runRoots(size_t from, size_t to) {
+  slabs++;
+  peakResident = std::max(peakResident, edgeList.edges.size());
+  // Every policy searches the replicas, so they must hold the new edges
+  if (NUMA) mirror();
+  if (NUMA && !config.fullAsync) {
+    // Each CU still sees its root tasks in order, so cycle counts match
+    runLocal(from, to, false);
+    return;
+  }
+  tQ.setup(NUMA ? *replicas.at(0) : edgeList, tM.motif, from, to);
 #pragma omp parallel
   {
     #pragma omp single
@@ -396,9 +1396,9 @@ void Mint::run() {
       while (!tQ.tasks.empty()) {
         int nextCU = 0;
         size_t minCycles = (size_t)-1;
-        if (FULL_ASYNC) {
+        if (config.fullAsync) {
           // Find CU that is earliest in time to give a task to
-          for (size_t i = 0; i < NUM_CUS; i++) {
+          for (size_t i = 0; i < config.numCUs; i++) {
             if (cUnits.at(i)->cycles < minCycles) {
               nextCU = i;
               minCycles = cUnits.at(i)->cycles;
@@ -406,16 +1406,19 @@ void Mint::run() {
           }
         } else {
           // Do static assignment like in the paper
-          nextCU = tQ.tasks.front().eG % NUM_CUS;
+          nextCU = tQ.tasks.front().eG % config.numCUs;
           minCycles = cUnits.at(nextCU)->cycles;
         }
         Task nextTask = tQ.tasks.front();
         if (VERBOSE) std::cout << "Executing root task " << nextTask.eG << " with CU " <<
                          nextCU << " at cycle " << minCycles << std::endl;
-#pragma omp task depend(inout: cUnits.at(nextCU)) firstprivate(nextTask, tQ, tM, edgeList) shared(results)
-        {
-          cUnits.at(nextCU)->cycles += DEQUEUE_LATENCY;
+        if (config.fullAsync && config.inOrder) {
           cUnits.at(nextCU)->executeRootTask(nextTask);
+        } else {
+#pragma omp task depend(inout: cUnits.at(nextCU)) firstprivate(nextTask)
+          {
+            cUnits.at(nextCU)->executeRootTask(nextTask);
+          }
         }
         tQ.tasks.pop();
         if (VERBOSE) std::cout << "There are " << results.store.size() <<
@@ -425,22 +1428,235 @@ void Mint::run() {
       }
     }
   } // implied taskwait
+  return;
+}
+
+size_t Mint::oldestRoot() {
+  size_t oldest = SIZE_MAX;
+  for (size_t i = 0; i < config.numCUs; i++) {
+    for (size_t j = 0; j < NUM_CONTEXTS; j++) {
+      HwContext* ctx = cUnits.at(i)->contexts.at(j);
+      if (ctx->active) oldest = std::min(oldest, (size_t)ctx->sEng.root_eG);
+    }
+  }
+  return oldest;
+}
+
+void Mint::settle() {
+  // Replicas pick up the adopted counts like any other change to edgeList
+  if (NUMA) mirror();
+#pragma omp parallel
+  {
+    #pragma omp single
+    {
+      for (size_t i = 0; i < config.numCUs; i++) {
+#pragma omp task depend(inout: cUnits.at(i)) shared(cUnits)
+        cUnits.at(i)->settle();
+      }
+    }
+  } // implied taskwait
+  return;
+}
+
+void Mint::complete() {
+  // Let each CU finish the root tasks still bound to its contexts
+  if (NUMA && !config.fullAsync) {
+    runLocal(0, 0, true);
+  } else {
+#pragma omp parallel
+    {
+      #pragma omp single
+      {
+        for (size_t i = 0; i < config.numCUs; i++) {
+#pragma omp task depend(inout: cUnits.at(i)) shared(cUnits)
+          cUnits.at(i)->drain();
+        }
+      }
+    } // implied taskwait
+  }
+  if (DRAM_MODEL) {
+    dram.solve();
+    // Each CU is held up by the queueing delay of its own transfers and by
+    // the epochs it spans that need more bandwidth than the channels have
+    for (size_t i = 0; i < config.numCUs; i++) {
+      cUnits.at(i)->cycles += (size_t)dram.charge(cUnits.at(i)->lines,
+                                                  cUnits.at(i)->cycles);
+    }
+  }
   // Collect cycle stats
-  size_t maxCycles = 0;
-  size_t totalCycles = 0;
-  for (size_t i = 0; i < NUM_CUS; i++) {
-    if (cUnits.at(i)->cycles > maxCycles) {
-      maxCycles = cUnits.at(i)->cycles;
+  for (size_t i = 0; i < config.numCUs; i++) {
+    if (cUnits.at(i)->cycles > endToEnd) {
+      endToEnd = cUnits.at(i)->cycles;
     }
     totalCycles += cUnits.at(i)->cycles;
+    busyCycles += cUnits.at(i)->busy;
   }
+  return;
+}
+
+void Mint::finish() {
+  complete();
   if (VERBOSE) printResults();
   std::cout << "Total cycles taken: " << totalCycles << std::endl;
-  std::cout << "End-to-end cycle count: " << maxCycles << std::endl;
+  std::cout << "End-to-end cycle count: " << endToEnd << std::endl;
+  if (DRAM_MODEL && dram.lines > 0) {
+    double peak = (double)DRAM_CHANNELS*DRAM_BW;
+    double achieved = dram.lines*LINE_SIZE/endToEnd;
+    std::cout << "DRAM lines transferred: " << (size_t)dram.lines << std::endl;
+    std::cout << "Achieved DRAM bandwidth: " << achieved << " bytes/cycle (" <<
+        100.0*achieved/peak << "% of peak)" << std::endl;
+    std::cout << "Average DRAM queueing delay: " << dram.queued/dram.lines <<
+        " cycles" << std::endl;
+    std::cout << "Saturated DRAM epochs: " << dram.saturated << " of " <<
+        dram.demand.size() << " (" << dram.epoch << " cycles each)" <<
+        std::endl;
+  }
+  if (NUM_CONTEXTS > 1) {
+    std::cout << "Hardware contexts per CU: " << NUM_CONTEXTS << std::endl;
+    std::cout << "Shared pipeline utilization: " <<
+        100.0*busyCycles/((double)endToEnd*config.numCUs) << "%" << std::endl;
+  }
+  if (OUT_OF_CORE) {
+    std::cout << "Root slabs run: " << slabs << std::endl;
+    std::cout << "Peak resident edges: " << peakResident << " of " <<
+        edgeList.size() << std::endl;
+  }
+  if (NUMA && !config.fullAsync) printNuma();
   std::cout << "There are " << results.store.size() << " results" << std::endl;
-  for (size_t i = 0; i < NUM_CUS; i++) {
-    delete cMems.at(i);
-    delete cUnits.at(i);
+  if (TRACE) writeTrace();
+  return;
+}
+
+size_t Tuner::evaluate(MintConfig c) {
+  for (size_t i = 0; i < points.size(); i++) {
+    MintConfig& p = points.at(i).config;
+    if (p.numCUs == c.numCUs && p.fullAsync == c.fullAsync &&
+        p.useMemo == c.useMemo &&
+        (!c.useMemo || p.memoThresh == c.memoThresh)) {
+      return points.at(i).endToEnd;
+    }
+  }
+  if (points.size() >= budget) return SIZE_MAX;
+  // FULL_ASYNC points are compared with each other, so they must not depend
+  // on host thread timing
+  c.inOrder = true;
+  // Each run gets its own copy of the already loaded graph
+  Mint mint(tM, edgeList, c);
+  mint.runRoots(0, edgeList.size());
+  mint.complete();
+  points.push_back(TunePoint{c, mint.endToEnd, mint.totalCycles,
+                             mint.results.store.size()});
+  std::cout << "Tuning run " << points.size() << ": NUM_CUS=" << c.numCUs <<
+      " FULL_ASYNC=" << c.fullAsync << " USE_MEMO=" << c.useMemo;
+  if (c.useMemo) std::cout << " MEMO_THRESH=" << c.memoThresh;
+  std::cout << " takes " << mint.endToEnd << " cycles" << std::endl;
+  return mint.endToEnd;
+}
+
+void Tuner::tuneThresh(MintConfig& c) {
+  // Thresholds 0, 1, 2, 4, ... up to TUNE_MAX_THRESH
+  auto thresh = [](size_t k) { return k == 0 ? 0 : (size_t)1 << (k - 1); };
+  auto cost = [&](size_t k) {
+    MintConfig t = c;
+    t.memoThresh = thresh(k);
+    return evaluate(t);
+  };
+  size_t lo = 0;
+  size_t hi = 0;
+  while (thresh(hi) < TUNE_MAX_THRESH) hi++;
+  const double ratio = (std::sqrt(5.0) - 1)/2;
+  while (hi - lo > 2) {
+    size_t a = hi - (size_t)std::round((hi - lo)*ratio);
+    size_t b = lo + (size_t)std::round((hi - lo)*ratio);
+    if (a >= b) b = a + 1;
+    if (cost(a) <= cost(b)) {
+      hi = b;
+    } else {
+      lo = a;
+    }
+  }
+  size_t best = lo;
+  for (size_t k = lo + 1; k <= hi; k++) {
+    if (cost(k) < cost(best)) best = k;
+  }
+  c.memoThresh = thresh(best);
+  return;
+}
+
+TunePoint& Tuner::best() {
+  size_t best = 0;
+  for (size_t i = 1; i < points.size(); i++) {
+    if (points.at(i).endToEnd < points.at(best).endToEnd ||
+        (points.at(i).endToEnd == points.at(best).endToEnd &&
+         points.at(i).config.numCUs < points.at(best).config.numCUs)) {
+      best = i;
+    }
+  }
+  return points.at(best);
+}
+
+void Tuner::search() {
+  // Coarse pass over policy and memo settings at the compile-time CU count
+  for (int policy = 0; policy < 2; policy++) {
+    MintConfig c;
+    c.fullAsync = policy;
+    c.useMemo = false;
+    evaluate(c);
+    c.useMemo = true;
+    tuneThresh(c);
+  }
+  if (points.empty()) return;
+  // Sweep CU count with the best settings so far, then refine the memo
+  // threshold for the best CU count
+  MintConfig c = best().config;
+  for (size_t n = TUNE_MIN_CUS; n <= TUNE_MAX_CUS; n *= 2) {
+    c.numCUs = n;
+    evaluate(c);
+  }
+  c = best().config;
+  c.useMemo = true;
+  tuneThresh(c);
+  return;
+}
+
+void Tuner::report() {
+  if (points.empty()) {
+    std::cerr << "Error: tuning budget allows no runs." << std::endl;
+    return;
+  }
+  TunePoint& b = best();
+  std::cout << "Best configuration: NUM_CUS=" << b.config.numCUs <<
+      " FULL_ASYNC=" << b.config.fullAsync << " USE_MEMO=" <<
+      b.config.useMemo;
+  if (b.config.useMemo) std::cout << " MEMO_THRESH=" << b.config.memoThresh;
+  std::cout << std::endl;
+  std::cout << "End-to-end cycle count: " << b.endToEnd << std::endl;
+  std::ofstream out(TUNE_FILE);
+  if (!out.is_open()) {
+    std::cerr << "Error: could not open tuning file " << TUNE_FILE <<
+        std::endl;
+    return;
+  }
+  out << "num_cus,full_async,use_memo,memo_thresh,end_to_end_cycles," <<
+      "total_cycles,results,frontier" << std::endl;
+  for (size_t i = 0; i < points.size(); i++) {
+    TunePoint& p = points.at(i);
+    // On the frontier if no other point is as fast with as few CUs
+    bool frontier = true;
+    for (size_t j = 0; j < points.size(); j++) {
+      TunePoint& q = points.at(j);
+      if (q.config.numCUs <= p.config.numCUs && q.endToEnd <= p.endToEnd &&
+          (q.config.numCUs < p.config.numCUs || q.endToEnd < p.endToEnd)) {
+        frontier = false;
+      }
+    }
+    out << p.config.numCUs << "," << p.config.fullAsync << "," <<
+        p.config.useMemo << "," << (p.config.useMemo ? p.config.memoThresh : 0) <<
+        "," << p.endToEnd << "," << p.totalCycles << "," << p.results << "," <<
+        frontier << std::endl;
   }
+  out.close();
+  std::cout << "Wrote " << points.size() << " tuning runs to " << TUNE_FILE <<
+      std::endl;
   return;
 }
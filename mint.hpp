@@ -12,6 +12,9 @@
 #define VERBOSE 0
 #define VVERBOSE 0
 #define FULL_ASYNC 0
+#ifndef NUM_CONTEXTS
+#define NUM_CONTEXTS 1
+#endif
 #define DEQUEUE_LATENCY 1
 #define CMEM_LATENCY 2
 #define CACHE_LATENCY 2
@@ -27,12 +30,99 @@
 #endif
 #define CACHE_HIT (1-CACHE_MISS)
 #define CACHE_EXP ((int)(DRAM_LATENCY*CACHE_MISS) + (int)(CACHE_LATENCY*CACHE_HIT))
+#ifndef DRAM_MODEL
+#define DRAM_MODEL 0
+#endif
+#ifndef DRAM_CHANNELS
+#define DRAM_CHANNELS 8
+#endif
+#ifndef DRAM_BW
+#define DRAM_BW 32
+#endif
+#ifndef LINE_SIZE
+#define LINE_SIZE 64
+#endif
+#ifndef DRAM_EPOCH
+#define DRAM_EPOCH 1000
+#endif
+#ifndef DRAM_MAX_UTIL
+#define DRAM_MAX_UTIL 0.95
+#endif
+#ifndef DRAM_BINS
+#define DRAM_BINS (1 << 16)
+#endif
 #ifndef USE_MEMO
 #define USE_MEMO 0
 #endif
 #ifndef MEMO_THRESH
 #define MEMO_THRESH 256
 #endif
+#ifndef HOST_SPLIT
+#define HOST_SPLIT 0
+#endif
+#ifndef SPLIT_THRESH
+#define SPLIT_THRESH 4096
+#endif
+#ifndef SPLIT_DEPTH
+#define SPLIT_DEPTH 2
+#endif
+#ifndef SPLIT_PENDING
+#define SPLIT_PENDING 256
+#endif
+#ifndef OUT_OF_CORE
+#define OUT_OF_CORE 0
+#endif
+#ifndef SLAB_EDGES
+#define SLAB_EDGES (1 << 20)
+#endif
+#ifndef PIPELINE
+#define PIPELINE 0
+#endif
+#ifndef PIPELINE_BATCH
+#define PIPELINE_BATCH 4096
+#endif
+#ifndef TUNE
+#define TUNE 0
+#endif
+#ifndef TUNE_BUDGET
+#define TUNE_BUDGET 32
+#endif
+#ifndef TUNE_MIN_CUS
+#define TUNE_MIN_CUS 32
+#endif
+#ifndef TUNE_MAX_CUS
+#define TUNE_MAX_CUS 2048
+#endif
+#ifndef TUNE_MAX_THRESH
+#define TUNE_MAX_THRESH 4096
+#endif
+#ifndef TUNE_FILE
+#define TUNE_FILE "mint-tune.csv"
+#endif
+#ifndef NUMA
+#define NUMA 0
+#endif
+#ifndef NUMA_NODES
+#define NUMA_NODES 0
+#endif
+#ifndef TRACE
+#define TRACE 0
+#endif
+#ifndef TRACE_FILE
+#define TRACE_FILE "mint-trace.json"
+#endif
+#ifndef TRACE_BUF_SIZE
+#define TRACE_BUF_SIZE 4096
+#endif
+#ifndef TRACE_SAMPLE
+#define TRACE_SAMPLE 1
+#endif
+#ifndef TRACE_BEGIN
+#define TRACE_BEGIN 0
+#endif
+#ifndef TRACE_END
+#define TRACE_END SIZE_MAX
+#endif
 
 // *****************************************************************************
 // *                             Data Structures                               *
@@ -49,6 +139,94 @@ class Edge {
   Edge(): Edge(0, 0, 0) {}
 };
 
+// Edge counts per key, kept as sorted parallel arrays (12 bytes per distinct
+// key) rather than a hash map. New keys wait in pending until seal().
+class CountTable {
+ public:
+  std::vector<uint64_t> keys;
+  std::vector<uint32_t> counts;
+  std::vector<uint64_t> pending;
+
+  // Count one more edge under key.
+  void add(uint64_t key);
+
+  // Merge the pending keys into the sorted counts.
+  void seal();
+
+  // Number of edges counted under key, which must be sealed.
+  size_t get(uint64_t key);
+};
+
+class EdgeStore {
+ public:
+  std::vector<Edge> edges;
+  size_t base = 0;
+  size_t total = 0;
+  bool counted = false;
+  bool partial = false;
+  CountTable outTotal;
+  CountTable inTotal;
+  CountTable pairTotal;
+  CountTable outBefore;
+  CountTable inBefore;
+  CountTable pairBefore;
+
+  EdgeStore() {}
+
+  // Hold the whole graph in memory.
+  EdgeStore(std::vector<Edge>& e): edges(e), total(e.size()) {}
+
+  // Return the edge at global index i, which must be resident.
+  Edge& at(size_t i) {
+    return edges.at(i - base);
+  }
+
+  // Number of edges in the whole graph.
+  size_t size() {
+    return total;
+  }
+
+  // Global index one past the last resident edge.
+  size_t loaded() {
+    return base + edges.size();
+  }
+
+  // Add e to the per-vertex edge totals of the whole graph, ahead of
+  // streaming it in.
+  void count(Edge& e);
+
+  // Finish counting, the totals can only be looked up after this.
+  void seal();
+
+  // Take the sealed graph totals of counts, which a loader filled in while
+  // this store was partial and growing with every append.
+  void adopt(EdgeStore& counts);
+
+  // Make e resident as the next edge of the graph.
+  void append(Edge& e);
+
+  // Drop the resident edges below global index to.
+  void evict(size_t to);
+
+  // Bring this copy up to date with from, copying only what changed.
+  void mirror(EdgeStore& from);
+
+  // Number of edges below the resident ones that match the given endpoints.
+  size_t before(bool uCheck, bool vCheck, int uG, int vG);
+
+  // Number of edges in the whole graph that match the given endpoints.
+  size_t matches(bool uCheck, bool vCheck, int uG, int vG);
+
+  // Number of edges past the resident ones that match the given endpoints,
+  // given that resident of the resident edges match.
+  size_t after(bool uCheck, bool vCheck, int uG, int vG, size_t resident);
+
+ private:
+  uint64_t pairKey(int u, int v) {
+    return ((uint64_t)(uint32_t)u << 32) | (uint32_t)v;
+  }
+};
+
 class Mapping {
  public:
   int mNode;
@@ -95,8 +273,12 @@ class TaskQueue {
  public:
   std::queue<Task> tasks;
 
-  // Fill TaskQueue with a root task for every node in graph.
-  void setup(std::vector<Edge>& edgeList, std::vector<Edge>& motif);
+  // Fill TaskQueue with a root task for every edge in [from, to).
+  void setup(EdgeStore& edgeList, std::vector<Edge>& motif, size_t from,
+             size_t to);
+
+  // Root task for the edge at global index i.
+  Task root(EdgeStore& edgeList, std::vector<Edge>& motif, size_t i);
 };
 
 class TargetMotif {
@@ -125,29 +307,119 @@ class MappingStore {
 
   // Store CAM of found motif.
   void addResult(ContextMem& cMem);
+
+  // Store CAMs of motifs found by a split search tree, in order.
+  void addResults(std::vector<std::vector<Mapping>>& found);
+};
+
+class MemPort {
+ public:
+  size_t& cycles;
+  size_t stalls = 0;
+  double lines = 0;
+
+  // Link MemPort to the cycle count of a hardware context.
+  MemPort(size_t& cyc): cycles(cyc) {}
+
+  // Charge the expected latency of n cache accesses. Memory latency is also
+  // counted as stall time, which other contexts on the same CU can hide.
+  void cache(size_t n) {
+    stall(CACHE_EXP*n);
+    lines += CACHE_MISS*n;
+  }
+
+  // Charge n accesses known to hit in cache.
+  void cacheHit(size_t n) {
+    stall(CACHE_LATENCY*n);
+  }
+
+  // Charge n accesses that always go to DRAM.
+  void dram(size_t n) {
+    stall(DRAM_LATENCY*n);
+    lines += n;
+  }
+
+ private:
+  void stall(size_t c) {
+    cycles += c;
+    stalls += c;
+  }
+};
+
+// Line transfers per epoch of simulated time, in fixed point so sums do not
+// depend on the order they are added in. Each bin spans DRAM_EPOCH << width
+// cycles, and adjacent bins are merged whenever more than DRAM_BINS are needed.
+class DramDemand {
+ public:
+  std::vector<uint64_t> bins;
+  size_t width = 0;
+
+  // Spread n line transfers evenly over the simulated cycles [start, end).
+  void spread(double n, size_t start, size_t end);
+
+  // Merge adjacent bins until each spans DRAM_EPOCH << w cycles.
+  void coarsen(size_t w);
+};
+
+class DramModel {
+ public:
+  std::vector<DramDemand> threads;
+  DramDemand total;
+  std::vector<double> demand;
+  std::vector<double> delay;
+  std::vector<double> shift;
+  std::vector<double> waited;
+  std::vector<double> moved;
+  size_t epoch = DRAM_EPOCH;
+  double lines = 0;
+  double queued = 0;
+  size_t saturated = 0;
+
+  // Spread n line transfers over the cycles [start, end) of the demand of the
+  // calling thread.
+  void spread(double n, size_t start, size_t end);
+
+  // Sum the demand of all threads, find the average queueing delay of a
+  // transfer issued in each epoch, and how far each epoch is stretched when
+  // its demand exceeds the bandwidth of all channels.
+  void solve();
+
+  // Cycles added to a ComputeUnit that moved n lines and finished at
+  // simulated cycle end.
+  double charge(double n, size_t end);
 };
 
 class Memo {
  public:
   int listIndex;
+  size_t root;
 };
 
 class MemoStruct {
  public:
   std::unordered_map<size_t, Memo> outgoing;
   std::unordered_map<size_t, Memo> incoming;
+  size_t hits = 0;
+  bool enabled = USE_MEMO;
+  size_t thresh = MEMO_THRESH;
   
   // Return memoized starting index as appropriate given context
   size_t getStart(bool uCheck, bool vCheck, int uG, int vG, int eG,
-                  size_t size, size_t& cycles) {
-    if ((USE_MEMO && size > MEMO_THRESH) && uCheck != vCheck) {
+                  size_t size, MemPort& mem) {
+    if ((enabled && size > thresh) && uCheck != vCheck) {
       if (VVERBOSE) std::cout << "Checking for memo" << std::endl;
-      cycles += JMP_LATENCY*2;
-      if (uCheck && outgoing.find(uG) != outgoing.end()) {
-        cycles += CACHE_LATENCY;
+      mem.cycles += JMP_LATENCY*2;
+      // An entry recorded for a later root task by another context of this CU
+      // may skip edges this search still needs
+      if (uCheck && outgoing.find(uG) != outgoing.end() &&
+          outgoing[uG].root <= (size_t)eG) {
+        mem.cacheHit(1);
+        if (TRACE) hits++;
         return outgoing[uG].listIndex;
-      } else if (vCheck && incoming.find(vG) != incoming.end()) {
-        cycles += CACHE_LATENCY;
+      } else if (vCheck && incoming.find(vG) != incoming.end() &&
+                 incoming[vG].root <= (size_t)eG) {
+        mem.cacheHit(1);
+        if (TRACE) hits++;
         return incoming[vG].listIndex;
       } else {
         return 0;
@@ -159,22 +431,25 @@ class MemoStruct {
 
   // Memoize search index if appropriate
   void record(bool uCheck, bool vCheck, int uG, int vG, size_t root_eG,
-              size_t qI, size_t i, bool& recorded, size_t size, size_t& cycles) {
-    if (USE_MEMO && ((size > MEMO_THRESH && !recorded) && (uCheck != vCheck))) {
+              bool pastRoot, size_t i, bool& recorded, size_t size,
+              MemPort& mem) {
+    if (enabled && ((size > thresh && !recorded) && (uCheck != vCheck))) {
       if (VVERBOSE) std::cout << "Trying to record memo" << std::endl;
-      cycles += JMP_LATENCY*2;
-      if (uCheck && (outgoing.find(uG) == outgoing.end() && qI >= root_eG)) {
+      mem.cycles += JMP_LATENCY*2;
+      if (uCheck && (outgoing.find(uG) == outgoing.end() && pastRoot)) {
         outgoing[uG] = Memo();
         outgoing[uG].listIndex = i;
+        outgoing[uG].root = root_eG;
         recorded = true;
-        cycles += DRAM_LATENCY;
+        mem.dram(1);
         return;
       } else if (vCheck &&
-                 (incoming.find(vG) == incoming.end() && qI >= root_eG)) {
+                 (incoming.find(vG) == incoming.end() && pastRoot)) {
         incoming[vG] = Memo();
         incoming[vG].listIndex = i;
+        incoming[vG].root = root_eG;
         recorded = true;
-        cycles += DRAM_LATENCY;
+        mem.dram(1);
         return;
       }
     } else {
@@ -183,6 +458,54 @@ class MemoStruct {
   }
 };
 
+class MemoQuery {
+ public:
+  bool uCheck;
+  bool vCheck;
+  int uG;
+  int vG;
+  size_t eG;
+  size_t size;
+  size_t first;
+  int root;
+  bool open = false;
+  bool unmatched = false;
+};
+
+class TraceEvent {
+ public:
+  const char* name;
+  char phase;
+  size_t ts;
+  size_t dur;
+  size_t root;
+};
+
+class TraceBuffer {
+ public:
+  std::vector<TraceEvent> events;
+  size_t head = 0;
+  size_t dropped = 0;
+  bool sampled = false;
+  size_t root = 0;
+
+  // Decide whether the events of the root task starting at eG are recorded.
+  void sample(size_t eG);
+
+  // Record a complete event spanning simulated cycles [start, end). Once the
+  // ring is full the oldest event is overwritten.
+  void record(const char* name, size_t start, size_t end);
+
+  // Record an instant event at the given simulated cycle.
+  void mark(const char* name, size_t at);
+
+  // Write buffered events, oldest first, as Chrome trace JSON objects.
+  void write(std::ostream& out, size_t tid, bool& first);
+
+ private:
+  void push(TraceEvent e);
+};
+
 // *****************************************************************************
 // *                         Architecture Components                           *
 // *****************************************************************************
@@ -193,14 +516,16 @@ class ContextMgr {
  public:
   ContextMem& cMem;
   MappingStore& results;
-  std::vector<Edge>& edgeList;
+  EdgeStore& edgeList;
   size_t& cycles;
+  MemPort& mem;
   int motifSize;
   int motifTime;
 
   // Link ContextMem, edgeList, and MappingStore to ContextMgr.
-  ContextMgr(ContextMem& c, MappingStore& r, std::vector<Edge>& eL, size_t& cyc):
-      cMem(c), results(r), edgeList(eL), cycles(cyc) {}
+  ContextMgr(ContextMem& c, MappingStore& r, EdgeStore& eL, size_t& cyc,
+             MemPort& mp):
+      cMem(c), results(r), edgeList(eL), cycles(cyc), mem(mp) {}
 
   // Update ContextMem according to info in task. Returns a status code to
   // direct the ComputeUnit how to continue.
@@ -224,64 +549,370 @@ class Dispatcher {
 class SearchEng {
  public:
   ContextMem& cMem;
-  std::vector<Edge>& edgeList;
+  EdgeStore& edgeList;
   size_t& cycles;
   MemoStruct& memo;
+  MemPort& mem;
   int root_eG;
+  size_t unloaded = 0;
+  std::vector<MemoQuery>* deferred = nullptr;
+  std::vector<MemoQuery> unsettled;
 
   // Link SearchEng to ContextMem.
-  SearchEng(ContextMem& c, std::vector<Edge>& eL, size_t& cyc, MemoStruct& m):
-      cMem(c), edgeList(eL), cycles(cyc), memo(m) {}
+  SearchEng(ContextMem& c, EdgeStore& eL, size_t& cyc, MemoStruct& m,
+            MemPort& mp):
+      cMem(c), edgeList(eL), cycles(cyc), memo(m), mem(mp) {}
 
   // Linear cache-line search for successor edges
   std::vector<size_t> searchPhaseOne(Task& task);
 
   // Linear mapping check over filtered edges
   void searchPhaseTwo(Task& task, std::vector<size_t> fEdges);
+
+  // Walk the adjacency-filtered edges of a phase one search from the memoized
+  // start index, charging the per-edge and memo costs.
+  void memoWalk(MemoQuery& q);
+
+  // Charge the searches made while the graph was still being counted, in the
+  // order they were made, now that the edges past the loaded ones are known.
+  void settle();
 };
 
-class ComputeUnit {
+class HwContext {
  public:
-  MappingStore& results;
-  TargetMotif& tM;
-  std::vector<Edge>& edgeList;
   size_t cycles = 0;
+  MemPort mem;
   ContextMem& cMem;
   ContextMgr cMgr;
   Dispatcher disp;
   SearchEng sEng;
+  TraceBuffer trace;
+  Task task;
+  bool active = false;
+  size_t ready = 0;
+  size_t rootStart = 0;
+  size_t nodes = 0;
+  size_t stepBase = 0;
+  size_t stepCycles = 0;
+
+  // Link the components of one hardware context to its ContextMem. The
+  // MemoStruct is shared by all contexts of a ComputeUnit.
+  HwContext(MappingStore& r, TargetMotif& t, EdgeStore& eL,
+            ContextMem& c, MemoStruct& m):
+      mem(cycles), cMem(c), cMgr(c, r, eL, cycles, mem), disp(c, t, cycles),
+      sEng(c, eL, cycles, m, mem) {}
+
+  // Simulated CU cycle the context has reached within the current step.
+  size_t now() {
+    return stepBase + (cycles - stepCycles);
+  }
+};
+
+class SplitMark {
+ public:
+  size_t query;
+  size_t result;
+  size_t cycles;
+  size_t stalls;
+  double lines;
+};
+
+class SplitPart {
+ public:
+  ContextMem cMem;
+  MappingStore results;
+  std::vector<MemoQuery> queries;
+  HwContext ctx;
+  size_t depth;
+  MgrStatus status = dispatch;
+  bool speculated = false;
+  ContextMem predicted;
+  size_t joined = 0;
+  std::vector<SplitPart*> children;
+  std::vector<SplitMark> marks;
+  HwContext* flushTo = nullptr;
+  // Endpoints of the last pushed edge as the last flushed child saw them
+  bool flushed = false;
+  int lastUG;
+  int lastVG;
+  int lastUM;
+  int lastVM;
+
+  // Copy the state of from into a private context that explores the subtree
+  // below the edge at the given stack depth. Memo lookups are deferred.
+  SplitPart(TargetMotif& t, EdgeStore& eL, MemoStruct& m,
+            HwContext& from, size_t d);
+
+  ~SplitPart();
+
+  // Return true iff the edge at depth has been popped.
+  bool closed() {
+    return cMem.eStack.size() < depth || status == end;
+  }
+
+  // Return true iff the part closed in the state its parent assumed.
+  bool closedAsPredicted();
+};
+
+class ComputeUnit {
+ public:
+  MappingStore& results;
+  TargetMotif& tM;
+  EdgeStore& edgeList;
+  size_t cycles = 0;
+  size_t engine = 0;
+  size_t busy = 0;
+  size_t steps = 0;
   MemoStruct memo;
+  std::vector<HwContext*> contexts;
+  DramModel* dram = nullptr;
+  double lines = 0;
+
+  // Link all components appropriately, with one hardware context per
+  // ContextMem.
+  ComputeUnit(MappingStore& r, TargetMotif& t, EdgeStore& eL,
+              std::vector<ContextMem*> c);
 
-  // Link all components appropriately.
-  ComputeUnit(MappingStore& r, TargetMotif& t, std::vector<Edge>& eL,
-              ContextMem& c):
-      results(r), tM(t), edgeList(eL), cMem(c),
-      cMgr(c, results, edgeList, cycles), disp(c, tM, cycles),
-      sEng(c, edgeList, cycles, memo) {}
+  ~ComputeUnit();
 
-  // Executes a root task to completion. Records total cycles taken. Writes
-  // resulting finds to the MappingStore.
+  // Bind a root task to a free hardware context. If no context is left free,
+  // simulate until one of them completes its root task. Writes resulting
+  // finds to the MappingStore.
   void executeRootTask(Task t);
+
+  // Simulate until every hardware context has completed its root task.
+  void drain();
+
+  // Charge every context for its unsettled searches.
+  void settle();
+
+ private:
+  // Step the context that is earliest in simulated time until one context
+  // completes its root task. The context manager, dispatcher and search
+  // engine are shared, so a step waits until they are free, but the memory
+  // stalls of one context overlap with the steps of the others.
+  void advance();
+
+  // Run one update, dispatch and search iteration of the root task bound to
+  // ctx, starting at simulated cycle base. Returns false once the search tree
+  // is complete.
+  bool step(HwContext& ctx, size_t base);
+
+  // Pass ctx's task through the context manager.
+  MgrStatus update(HwContext& ctx);
+
+  // Dispatch ctx's task and run both search phases.
+  void search(HwContext& ctx);
+
+  // Return true iff backtracking ctx's task pops the ContextMem edge stack.
+  bool pops(HwContext& ctx);
+
+  // Finish the root task bound to ctx as a tree of host tasks. Subtrees
+  // below shallow edges are explored concurrently, then their cycles, finds
+  // and memo lookups are charged to ctx in search tree order, so the result
+  // matches a serial run.
+  void splitRoot(HwContext& ctx);
+
+  // Explore until the edge at part's depth is popped. Each child edge pushed
+  // at up to SPLIT_DEPTH is handed to a host task, while part carries on
+  // with its next sibling, assuming the child leaves the context as it found
+  // it. If updated, part's task has already been through the context manager.
+  void explore(SplitPart& part, bool updated);
+
+  // Wait for part's children and check that each left the state part assumed.
+  // On a misprediction part is rolled back to that child's final state and
+  // true is returned.
+  bool join(SplitPart& part);
+
+  // Collect the joined children of an outermost part, and the part's own
+  // work before them, into part.flushTo and free them.
+  void flush(SplitPart& part);
+
+  // Charge the cycles and memo lookups of part and its children to ctx, and
+  // append their finds to found, in search tree order.
+  void collect(HwContext& ctx, SplitPart& part,
+               std::vector<std::vector<Mapping>>& found);
+};
+
+class NumaMap {
+ public:
+  std::vector<std::vector<int>> cpus;
+
+  // Read the CPUs of each NUMA node from sysfs. With NUMA_NODES set to fewer
+  // nodes, keep only the first ones. With more, split the CPUs evenly into
+  // that many nodes instead.
+  void detect();
+
+  // Fold the nodes past the first n into the others, so that every node
+  // keeps a host thread.
+  void limit(size_t n);
+
+  size_t nodes() {
+    return cpus.size();
+  }
+
+  // Node that host thread t of n runs on.
+  size_t node(size_t t, size_t n) {
+    return t*nodes()/n;
+  }
+
+  // First host thread of n that runs on node.
+  size_t first(size_t node, size_t n) {
+    return (node*n + nodes() - 1)/nodes();
+  }
+
+  // Number of host threads of n that run on node.
+  size_t count(size_t node, size_t n) {
+    return first(node + 1, n) - first(node, n);
+  }
+
+  // Host thread of n that copies the data of node: its first thread, or a
+  // thread of another node if it has none.
+  size_t lead(size_t node, size_t n) {
+    return count(node, n) > 0 ? first(node, n) : node % n;
+  }
+
+  // Pin the calling thread to a CPU of node, spreading threads by index.
+  void pin(size_t node, size_t index);
+};
+
+class MintConfig {
+ public:
+  size_t numCUs = NUM_CUS;
+  bool fullAsync = FULL_ASYNC;
+  bool useMemo = USE_MEMO;
+  size_t memoThresh = MEMO_THRESH;
+  // Hand out FULL_ASYNC roots one at a time, so the earliest CU is picked
+  // from up-to-date cycle counts and runs are repeatable
+  bool inOrder = false;
 };
 
 class Mint {
  public:
+  MintConfig config;
   std::vector<ComputeUnit*> cUnits;
   std::vector<ContextMem*> cMems;
   TaskQueue tQ;
   TargetMotif tM;
   MappingStore results;
-  std::vector<Edge> edgeList;
-
-  // Constructor
-  Mint(TargetMotif m, std::vector<Edge> e);
+  EdgeStore edgeList;
+  DramModel dram;
+  size_t slabs = 0;
+  size_t peakResident = 0;
+  size_t totalCycles = 0;
+  size_t endToEnd = 0;
+  size_t busyCycles = 0;
+  NumaMap numa;
+  std::vector<EdgeStore*> replicas;
+  std::vector<size_t> nodeRoots;
+  std::vector<size_t> nodeSteps;
+  std::vector<double> nodeSeconds;
+
+  // Constructor. The config overrides the compile-time CU count, scheduling
+  // policy and memo settings.
+  Mint(TargetMotif m, EdgeStore e, MintConfig c = MintConfig());
+
+  ~Mint();
+
+  // Run a root task for every edge of the graph, then report.
+  void run();
 
   // Start up each ComputeUnit loop, which will draw tasks from the TaskQueue to
-  // pass to ContextMgr. This continues until the TaskQueue is empty. Final
-  // cycle count is the max cycles taken over each ComputeUnit.
-  void run();
+  // pass to ContextMgr. This continues until every root task for the edges in
+  // [from, to) is complete or bound to a hardware context. The edges their
+  // windows reach must be resident.
+  void runRoots(size_t from, size_t to);
+
+  // Global index of the earliest root still bound to a hardware context, or
+  // SIZE_MAX if all are idle. Edges from it on must stay resident.
+  size_t oldestRoot();
+
+  // Charge the searches deferred while edgeList was partial, once it has
+  // adopted the counts of the whole graph.
+  void settle();
+
+  // Finish the root tasks still bound to hardware contexts and collect cycle
+  // counts. Final cycle count is the max cycles taken over each ComputeUnit.
+  void complete();
+
+  // Complete the run, then report cycle counts and results.
+  void finish();
 
  private:
   void printResults();
+
+  // Dump the per-CU trace buffers to TRACE_FILE.
+  void writeTrace();
+
+  // Create ComputeUnit i and its ContextMems over the given edges.
+  void buildUnit(size_t i, EdgeStore& eL);
+
+  // NUMA node whose memory holds the state of ComputeUnit cu.
+  size_t unitNode(size_t cu) {
+    return cu*numa.nodes()/config.numCUs;
+  }
+
+  // First ComputeUnit of the contiguous block held by node.
+  size_t firstUnit(size_t node) {
+    return (node*config.numCUs + numa.nodes() - 1)/numa.nodes();
+  }
+
+  // Take the next ComputeUnit for host thread t of n, counting taken CUs per
+  // node in next. Threads take the CUs of their own node, then those of
+  // nodes without a thread. Returns false once there are none left.
+  bool nextUnit(std::vector<size_t>& next, size_t t, size_t n, size_t& cu);
+
+  // Bring the edge replica of each node up to date with edgeList, from a
+  // thread pinned to that node.
+  void mirror();
+
+  // Run the root tasks for the edges in [from, to) with each host thread
+  // pinned to its node and taking whole CUs of that node as it becomes free,
+  // running each CU's root tasks in order. With drain set, the thread then
+  // also finishes the CU's bound root tasks.
+  void runLocal(size_t from, size_t to, bool drain);
+
+  // Print root tasks, search steps and host throughput per NUMA node.
+  void printNuma();
+};
+
+class TunePoint {
+ public:
+  MintConfig config;
+  size_t endToEnd;
+  size_t totalCycles;
+  size_t results;
+};
+
+class Tuner {
+ public:
+  TargetMotif& tM;
+  EdgeStore& edgeList;
+  size_t budget;
+  std::vector<TunePoint> points;
+
+  // Link the loaded graph and motif, which every evaluation reuses.
+  Tuner(TargetMotif& m, EdgeStore& e, size_t b): tM(m), edgeList(e),
+                                                 budget(b) {}
+
+  // Search the scheduling policy, memo settings and CU count for the lowest
+  // end-to-end cycle count, simulating at most budget configurations.
+  void search();
+
+  // Print the best configuration found and write every evaluated one to
+  // TUNE_FILE as CSV, marking those on the CU count versus cycles frontier.
+  void report();
+
+ private:
+  // Simulate c unless it was already evaluated. Returns its end-to-end cycle
+  // count, or SIZE_MAX once the budget is spent.
+  size_t evaluate(MintConfig c);
+
+  // Golden-section search over log2 of the memo threshold of c, which is
+  // left at the best threshold found.
+  void tuneThresh(MintConfig& c);
+
+  // Evaluated point with the fewest end-to-end cycles.
+  TunePoint& best();
 };
 